@@ -4,6 +4,8 @@
 #include <string>			 // string type
 #include <vector>			 // flexible arrays
 #include <map>				 // hashmaps
+#include <list>				 // font cache
+#include <climits>		 // bits per word in token bitsets
 #include <algorithm>	 // for sorting
 #include <chrono>			 // sleep and duration
 #include <thread>			 // main loop management
@@ -16,13 +18,21 @@
 #include <pwd.h>				 // used to get user home dir
 #include <future>
 #include <X11/extensions/Xrandr.h>
+#include <fcntl.h>	 // reading the snapshot and prefetching
+#include <link.h>		 // ELF headers, for finding shared libraries to prefetch
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#ifdef COUNT_ROUND_TRIPS
+#include <X11/Xproto.h> // xReply
+#include <dlfcn.h>
+#endif
 
 namespace fs = std::filesystem;
 using std::string, std::map, std::vector, std::ifstream, std::ofstream, std::stringstream, std::thread, std::promise;
 
 enum StyleAttribute
 {
-	NAME,
 	C_TITLE,
 	C_COMMENT,
 	C_BG,
@@ -35,22 +45,72 @@ enum StyleAttribute
 	F_LARGE // fonts
 };
 
+enum AtomName
+{
+	WM_WINDOW_TYPE,
+	WM_WINDOW_TYPE_DIALOG,
+	WM_STATE,
+	WM_STATE_ABOVE,
+	WM_STATE_MODAL,
+	MOTIF_WM_HINTS,
+	ATOM_COUNT
+};
+
 struct Keyword
 {
 	string word;
 	int weight;
 };
 
+struct Action
+{ // a [Desktop Action] of an application, which shares the application's other details
+	string key, name, cmd; // key is the X in [Desktop Action X]
+	vector<Keyword> keywords;
+};
+
 struct Application
 {
 	string id, name, genericName, comment, cmd;
 	vector<Keyword> keywords;
+	vector<Action> actions;
+};
+
+struct Theme
+{
+	const char *name;
+	unsigned int colors[5]; // 0xrrggbb, in the same order as COLORS
+};
+
+struct Palette
+{
+	bool allocated;
+	XftColor colors[C_MATCH + 1]; // indexed by StyleAttribute
+};
+
+struct CachedFont
+{
+	string pattern; // font name as configured, e.g. "Ubuntu,sans-11:bold"
+	int size;				// size after scaling
+	XftFont *font;
+	bool prefetched; // opened ahead of time and not used yet
 };
 
 struct Result
 {
 	Application *app;
-	int score;
+	long score;
+	const Action *action; // NULL unless the result is one of app's actions
+
+	string id() const { return action ? app->id + "#" + action->key : app->id; } // built when needed rather than stored per action
+	const string &name() const { return action ? action->name : app->name; }
+	const string &comment() const { return action ? app->name : app->comment; } // actions are described by their app
+	const string &cmd() const { return action ? action->cmd : app->cmd; }
+};
+
+struct TokenMatches
+{
+	vector<unsigned long> bits; // one bit per entry which has a keyword containing the token
+	vector<int> scores;					// score of the first matching keyword of each entry
 };
 
 const int BASE_DPI = 96;
@@ -60,13 +120,45 @@ const int TEXT_OFFSET = 0.63 * ROW_HEIGHT;
 const int BORDER_WIDTH = 3;
 const int INDENT = 14;
 const int COMMENT_SPACE = 8;
+const int MAX_ROWS = 10; // number of results visible at once
+const int SNAPSHOT_SIZE = MAX_ROWS;
+const int ACTION_PENALTY = 100; // actions matching through their app's keywords rank this many times lower than it
+const int FONT_CACHE_SIZE = 40;		// fonts which have been used
+const int FONT_PREFETCH_SIZE = 10; // fonts opened ahead of time, kept separately so they don't push each other out
+const float SCALE_STEP = 0.1f;
+const int PREFETCH_DELAY = 150;						// ms the selection must stay put before its binary is prefetched
+const long PREFETCH_BUDGET = 64 << 20;		// maximum bytes to read ahead for one app
+const long PREFETCH_TOTAL_BUDGET = 256 << 20; // maximum bytes to read ahead over the whole run
+const int PREFETCH_MAX_LIBRARIES = 32;
 const string HOME_DIR = getenv("HOME") != NULL ? getenv("HOME") : getpwuid(getuid())->pw_dir;
 const string CONFIG_DIR = getenv("XDG_CONFIG_HOME") != NULL ? getenv("XDG_CONFIG_HOME") : HOME_DIR + "/.config";
 const string DATA_DIR = getenv("XDG_DATA_HOME") != NULL ? getenv("XDG_DATA_HOME") : HOME_DIR + "/.local/share";
+const string CACHE_DIR = getenv("XDG_CACHE_HOME") != NULL ? getenv("XDG_CACHE_HOME") : HOME_DIR + "/.cache";
 const string CONFIG = CONFIG_DIR + "/launcher.conf";
-const string APP_DIRS[] = {"/usr/share/applications", "/usr/local/share/applications", DATA_DIR + "/applications"};
+const string SNAPSHOT = CACHE_DIR + "/launcher.snapshot"; // most launched apps, shown before the full list is loaded
+vector<string> appDirs()
+{ // the applications dir of each of XDG_DATA_DIRS, then the user's own
+	vector<string> dirs;
+	const char *dataDirs = getenv("XDG_DATA_DIRS");
+	stringstream ss(dataDirs != NULL && dataDirs[0] != '\0' ? dataDirs : "/usr/local/share:/usr/share");
+	string dir;
+	while (getline(ss, dir, ':'))
+	{
+		if (!dir.empty())
+		{
+			dirs.push_back(dir + "/applications");
+		}
+	}
+	dirs.push_back(DATA_DIR + "/applications");
+	return dirs;
+}
+const vector<string> APP_DIRS = appDirs();
+const char *LATENCY_LOG = getenv("LAUNCHER_LATENCY_LOG"); // if set, key press to paint times are written here on exit
+// shared libraries are only looked for here - DT_RUNPATH and ld.so.conf are ignored, so prefetching them is best effort
+const string LIBRARY_DIRS[] = {"/usr/local/lib", "/usr/lib/x86_64-linux-gnu", "/lib/x86_64-linux-gnu", "/usr/lib64", "/lib64", "/usr/lib", "/lib"};
 const StyleAttribute COLORS[] = {C_TITLE, C_COMMENT, C_BG, C_HIGHLIGHT, C_MATCH};
 const StyleAttribute FONTS[] = {F_REGULAR, F_BOLD, F_SMALLREGULAR, F_SMALLBOLD, F_LARGE};
+const char *ATOM_NAMES[] = {"_NET_WM_WINDOW_TYPE", "_NET_WM_WINDOW_TYPE_DIALOG", "_NET_WM_STATE", "_NET_WM_STATE_ABOVE", "_NET_WM_STATE_MODAL", "_MOTIF_WM_HINTS"};
 
 map<string, int> launches = {};
 
@@ -82,106 +174,102 @@ map<StyleAttribute, const string> STYLE_ATTRIBUTES = {
 		{F_SMALLBOLD, "smallbold"},
 		{F_LARGE, "large"}};
 
-map<StyleAttribute, string> STYLE_DEFAULTS = {
-		{C_TITLE, "#111111"},
-		{C_COMMENT, "#999999"},
-		{C_BG, "#ffffff"},
-		{C_HIGHLIGHT, "#f8c291"},
-		{C_MATCH, "#111111"},
+map<StyleAttribute, string> STYLE_DEFAULTS = { // default colors are those of the first theme
 		{F_REGULAR, "Ubuntu,sans-11"},
 		{F_BOLD, "Ubuntu,sans-11:bold"},
 		{F_SMALLREGULAR, "Ubuntu,sans-10"},
 		{F_SMALLBOLD, "Ubuntu,sans-10:bold"},
 		{F_LARGE, "Ubuntu,sans-20:light"}};
 
-vector<map<StyleAttribute, string>> THEMES = { // generated from http://daylerees.github.io/
-		{{NAME, "Default "}},											 // Default
-		{{NAME, "Mellow Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#7a7267"}, {C_BG, "#0b0a09"}, {C_HIGHLIGHT, "#13110f"}, {C_MATCH, "#1f8181"}},
-		{{NAME, "Legacy"}, {C_TITLE, "#aec2e0"}, {C_COMMENT, "#324357"}, {C_BG, "#14191f"}, {C_HIGHLIGHT, "#1b232c"}, {C_MATCH, "#ffffff"}},
-		{{NAME, "Slime Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#4f5a63"}, {C_BG, "#0b0c0d"}, {C_HIGHLIGHT, "#131516"}, {C_MATCH, "#6a9ec5"}},
-		{{NAME, "Peacock"}, {C_TITLE, "#ede0ce"}, {C_COMMENT, "#7a7267"}, {C_BG, "#2b2a27"}, {C_HIGHLIGHT, "#403c37"}, {C_MATCH, "#ff5d38"}},
-		{{NAME, "Earthsong Light"}, {C_TITLE, "#4d463e"}, {C_COMMENT, "#d6cab9"}, {C_BG, "#ffffff"}, {C_HIGHLIGHT, "#eeeeee"}, {C_MATCH, "#db784d"}},
-		{{NAME, "Zacks Contrast"}, {C_TITLE, "#f0f0f0"}, {C_COMMENT, "#777777"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#ff6a38"}},
-		{{NAME, "Laravel Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#615953"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#fc6b0a"}},
-		{{NAME, "Glowfish Contrast"}, {C_TITLE, "#6ea240"}, {C_COMMENT, "#3c4e2d"}, {C_BG, "#090b07"}, {C_HIGHLIGHT, "#12160d"}, {C_MATCH, "#db784d"}},
-		{{NAME, "Halflife"}, {C_TITLE, "#cccccc"}, {C_COMMENT, "#555555"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#282828"}, {C_MATCH, "#7d8991"}},
-		{{NAME, "Mud"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#c3b8b7"}, {C_BG, "#403635"}, {C_HIGHLIGHT, "#322a29"}, {C_MATCH, "#ff9787"}},
-		{{NAME, "Keen"}, {C_TITLE, "#cccccc"}, {C_COMMENT, "#374c60"}, {C_BG, "#111111"}, {C_HIGHLIGHT, "#222222"}, {C_MATCH, "#8767b7"}},
-		{{NAME, "Patriot Contrast"}, {C_TITLE, "#cad9e3"}, {C_COMMENT, "#515e66"}, {C_BG, "#0d0e0f"}, {C_HIGHLIGHT, "#191b1c"}, {C_MATCH, "#2e6fd9"}},
-		{{NAME, "Glowfish"}, {C_TITLE, "#6ea240"}, {C_COMMENT, "#3c4e2d"}, {C_BG, "#191f13"}, {C_HIGHLIGHT, "#222a1a"}, {C_MATCH, "#db784d"}},
-		{{NAME, "Tribal"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#4a4a54"}, {C_BG, "#19191d"}, {C_HIGHLIGHT, "#33333c"}, {C_MATCH, "#5f5582"}},
-		{{NAME, "Peel"}, {C_TITLE, "#edebe6"}, {C_COMMENT, "#585146"}, {C_BG, "#23201c"}, {C_HIGHLIGHT, "#403c37"}, {C_MATCH, "#d3643b"}},
-		{{NAME, "FreshCut Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#737b84"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#00a8c6"}},
-		{{NAME, "Earthsong Contrast"}, {C_TITLE, "#ebd1b7"}, {C_COMMENT, "#7a7267"}, {C_BG, "#12100f"}, {C_HIGHLIGHT, "#282521"}, {C_MATCH, "#db784d"}},
-		{{NAME, "Gloom"}, {C_TITLE, "#d8ebe5"}, {C_COMMENT, "#4f6e64"}, {C_BG, "#2a332b"}, {C_HIGHLIGHT, "#3c4d3e"}, {C_MATCH, "#ff5d38"}},
-		{{NAME, "Yule"}, {C_TITLE, "#ede0ce"}, {C_COMMENT, "#7a7267"}, {C_BG, "#2b2a27"}, {C_HIGHLIGHT, "#52504b"}, {C_MATCH, "#d63131"}},
-		{{NAME, "Darkside Contrast"}, {C_TITLE, "#bababa"}, {C_COMMENT, "#494b4d"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#e8341c"}},
-		{{NAME, "Mintchoc"}, {C_TITLE, "#bababa"}, {C_COMMENT, "#564439"}, {C_BG, "#2b221c"}, {C_HIGHLIGHT, "#3f322a"}, {C_MATCH, "#008d62"}},
-		{{NAME, "Potpourri"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#696363"}, {C_BG, "#2e2b2c"}, {C_HIGHLIGHT, "#403c37"}, {C_MATCH, "#ed1153"}},
-		{{NAME, "Juicy"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#777777"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#282828"}, {C_MATCH, "#3bc7b8"}},
-		{{NAME, "Snappy Light"}, {C_TITLE, "#555555"}, {C_COMMENT, "#bbbbbb"}, {C_BG, "#ffffff"}, {C_HIGHLIGHT, "#eeeeee"}, {C_MATCH, "#f66153"}},
-		{{NAME, "Goldfish Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#505c63"}, {C_BG, "#0c0d0e"}, {C_HIGHLIGHT, "#16181a"}, {C_MATCH, "#fa6900"}},
-		{{NAME, "Kiwi"}, {C_TITLE, "#edebe6"}, {C_COMMENT, "#354341"}, {C_BG, "#161a19"}, {C_HIGHLIGHT, "#282f2d"}, {C_MATCH, "#95c72a"}},
-		{{NAME, "Spearmint"}, {C_TITLE, "#719692"}, {C_COMMENT, "#93c7c0"}, {C_BG, "#e1f0ee"}, {C_HIGHLIGHT, "#ceebe7"}, {C_MATCH, "#25808a"}},
-		{{NAME, "Mud Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#524343"}, {C_BG, "#0d0b0b"}, {C_HIGHLIGHT, "#171413"}, {C_MATCH, "#f55239"}},
-		{{NAME, "Earthsong"}, {C_TITLE, "#ebd1b7"}, {C_COMMENT, "#7a7267"}, {C_BG, "#36312c"}, {C_HIGHLIGHT, "#45403b"}, {C_MATCH, "#db784d"}},
-		{{NAME, "Revelation Contrast"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#7b726b"}, {C_BG, "#0c0b0b"}, {C_HIGHLIGHT, "#1a1918"}, {C_MATCH, "#617fa0"}},
-		{{NAME, "Github"}, {C_TITLE, "#555555"}, {C_COMMENT, "#b8b6b1"}, {C_BG, "#ffffff"}, {C_HIGHLIGHT, "#eeeeee"}, {C_MATCH, "#008080"}},
-		{{NAME, "Turnip Contrast"}, {C_TITLE, "#ede0ce"}, {C_COMMENT, "#7a7267"}, {C_BG, "#080809"}, {C_HIGHLIGHT, "#1c1d1f"}, {C_MATCH, "#487d76"}},
-		{{NAME, "Iceberg"}, {C_TITLE, "#bdd6db"}, {C_COMMENT, "#537178"}, {C_BG, "#323b3d"}, {C_HIGHLIGHT, "#3e4c4f"}, {C_MATCH, "#2d8da1"}},
-		{{NAME, "Zacks"}, {C_TITLE, "#f0f0f0"}, {C_COMMENT, "#777777"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#333333"}, {C_MATCH, "#ff6a38"}},
-		{{NAME, "Snappy"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#696969"}, {C_BG, "#393939"}, {C_HIGHLIGHT, "#282828"}, {C_MATCH, "#f66153"}},
-		{{NAME, "Slate"}, {C_TITLE, "#ebebf4"}, {C_COMMENT, "#515166"}, {C_BG, "#19191f"}, {C_HIGHLIGHT, "#2a2a33"}, {C_MATCH, "#89a7b1"}},
-		{{NAME, "Shrek"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#555555"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#333333"}, {C_MATCH, "#857a5e"}},
-		{{NAME, "Patriot"}, {C_TITLE, "#cad9e3"}, {C_COMMENT, "#515e66"}, {C_BG, "#2d3133"}, {C_HIGHLIGHT, "#40484d"}, {C_MATCH, "#2e6fd9"}},
-		{{NAME, "Chocolate"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#795431"}, {C_BG, "#150f08"}, {C_HIGHLIGHT, "#362715"}, {C_MATCH, "#ccb697"}},
-		{{NAME, "Peacock Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#555555"}, {C_BG, "#0c0c0b"}, {C_HIGHLIGHT, "#151513"}, {C_MATCH, "#ff5d38"}},
-		{{NAME, "Super"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#465360"}, {C_BG, "#15191d"}, {C_HIGHLIGHT, "#242b32"}, {C_MATCH, "#d60257"}},
-		{{NAME, "Peacocks In Space"}, {C_TITLE, "#dee3ec"}, {C_COMMENT, "#6e7a94"}, {C_BG, "#2b303b"}, {C_HIGHLIGHT, "#272b34"}, {C_MATCH, "#ff5d38"}},
-		{{NAME, "Lavender Contrast"}, {C_TITLE, "#e0ceed"}, {C_COMMENT, "#614e6e"}, {C_BG, "#080709"}, {C_HIGHLIGHT, "#110e13"}, {C_MATCH, "#b657ff"}},
-		{{NAME, "Arstotzka"}, {C_TITLE, "#edebe6"}, {C_COMMENT, "#3f3a36"}, {C_BG, "#211f1e"}, {C_HIGHLIGHT, "#292725"}, {C_MATCH, "#516b6b"}},
-		{{NAME, "Slime"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#4f5a63"}, {C_BG, "#292d30"}, {C_HIGHLIGHT, "#384147"}, {C_MATCH, "#9fb3c2"}},
-		{{NAME, "Sourlick Contrast"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#615953"}, {C_BG, "#060606"}, {C_HIGHLIGHT, "#171615"}, {C_MATCH, "#8ac27a"}},
-		{{NAME, "Rainbow"}, {C_TITLE, "#c7d0d9"}, {C_COMMENT, "#424c55"}, {C_BG, "#16181a"}, {C_HIGHLIGHT, "#403c37"}, {C_MATCH, "#ef746f"}},
-		{{NAME, "Goldfish"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#505c63"}, {C_BG, "#2e3336"}, {C_HIGHLIGHT, "#465459"}, {C_MATCH, "#fa6900"}},
-		{{NAME, "Snappy Contrast"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#696969"}, {C_BG, "#0c0c0c"}, {C_HIGHLIGHT, "#181818"}, {C_MATCH, "#f66153"}},
-		{{NAME, "Revelation"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#7b726b"}, {C_BG, "#2e2c2b"}, {C_HIGHLIGHT, "#3b3633"}, {C_MATCH, "#617fa0"}},
-		{{NAME, "Frontier Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#7a7267"}, {C_BG, "#110f0e"}, {C_HIGHLIGHT, "#221f1c"}, {C_MATCH, "#f23a3a"}},
-		{{NAME, "Stark Contrast"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#615953"}, {C_BG, "#0b0a0a"}, {C_HIGHLIGHT, "#181716"}, {C_MATCH, "#f03113"}},
-		{{NAME, "Darkside"}, {C_TITLE, "#bababa"}, {C_COMMENT, "#494b4d"}, {C_BG, "#222324"}, {C_HIGHLIGHT, "#303333"}, {C_MATCH, "#e8341c"}},
-		{{NAME, "Solarflare Contrast"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#777777"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#ff4e50"}},
-		{{NAME, "Frontier"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#7a7267"}, {C_BG, "#36312c"}, {C_HIGHLIGHT, "#45403b"}, {C_MATCH, "#f23a3a"}},
-		{{NAME, "Tonic"}, {C_TITLE, "#eeeeee"}, {C_COMMENT, "#4a5356"}, {C_BG, "#2a2f31"}, {C_HIGHLIGHT, "#353b3e"}, {C_MATCH, "#b8cd44"}},
-		{{NAME, "Pastel"}, {C_TITLE, "#eeeeee"}, {C_COMMENT, "#444444"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#333333"}, {C_MATCH, "#04c4a5"}},
-		{{NAME, "Potpourri Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#696363"}, {C_BG, "#0d0c0c"}, {C_HIGHLIGHT, "#141313"}, {C_MATCH, "#ed1153"}},
-		{{NAME, "Tron"}, {C_TITLE, "#aec2e0"}, {C_COMMENT, "#324357"}, {C_BG, "#14191f"}, {C_HIGHLIGHT, "#1b232c"}, {C_MATCH, "#ffffff"}},
-		{{NAME, "Grunge"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#5c634f"}, {C_BG, "#31332c"}, {C_HIGHLIGHT, "#41453a"}, {C_MATCH, "#f56991"}},
-		{{NAME, "Bold"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#534b4b"}, {C_BG, "#2a2626"}, {C_HIGHLIGHT, "#393434"}, {C_MATCH, "#f0624b"}},
-		{{NAME, "Keen Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#374c60"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#8767b7"}},
-		{{NAME, "Crisp"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#574457"}, {C_BG, "#221a22"}, {C_HIGHLIGHT, "#1c151c"}, {C_MATCH, "#765478"}},
-		{{NAME, "Otakon"}, {C_TITLE, "#f9f3f9"}, {C_COMMENT, "#515166"}, {C_BG, "#171417"}, {C_HIGHLIGHT, "#332d33"}, {C_MATCH, "#f6e6eb"}},
-		{{NAME, "Carbonight"}, {C_TITLE, "#b0b0b0"}, {C_COMMENT, "#423f3d"}, {C_BG, "#2e2c2b"}, {C_HIGHLIGHT, "#3b3633"}, {C_MATCH, "#8c8c8c"}},
-		{{NAME, "FreshCut"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#737b84"}, {C_BG, "#2f3030"}, {C_HIGHLIGHT, "#383939"}, {C_MATCH, "#00a8c6"}},
-		{{NAME, "Juicy Contrast"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#777777"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#3bc7b8"}},
-		{{NAME, "Box UK"}, {C_TITLE, "#414f5c"}, {C_COMMENT, "#b8b6b1"}, {C_BG, "#ffffff"}, {C_HIGHLIGHT, "#eeeeee"}, {C_MATCH, "#019d76"}},
-		{{NAME, "Grunge Contrast"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#5c634f"}, {C_BG, "#0c0c0a"}, {C_HIGHLIGHT, "#1b1c18"}, {C_MATCH, "#f56991"}},
-		{{NAME, "Mellow"}, {C_TITLE, "#f8f8f2"}, {C_COMMENT, "#7a7267"}, {C_BG, "#36312c"}, {C_HIGHLIGHT, "#45403b"}, {C_MATCH, "#1f8181"}},
-		{{NAME, "Halflife Contrast"}, {C_TITLE, "#cccccc"}, {C_COMMENT, "#555555"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#7d8991"}},
-		{{NAME, "Hyrule Contrast"}, {C_TITLE, "#c0d5c1"}, {C_COMMENT, "#716d6a"}, {C_BG, "#0c0c0c"}, {C_HIGHLIGHT, "#141413"}, {C_MATCH, "#569e16"}},
-		{{NAME, "Iceberg Contrast"}, {C_TITLE, "#bdd6db"}, {C_COMMENT, "#537178"}, {C_BG, "#0b0e0e"}, {C_HIGHLIGHT, "#141718"}, {C_MATCH, "#2d8da1"}},
-		{{NAME, "Piggy"}, {C_TITLE, "#edebe6"}, {C_COMMENT, "#3f3236"}, {C_BG, "#1c1618"}, {C_HIGHLIGHT, "#34282c"}, {C_MATCH, "#fd6a5d"}},
-		{{NAME, "Hyrule"}, {C_TITLE, "#c0d5c1"}, {C_COMMENT, "#716d6a"}, {C_BG, "#2d2c2b"}, {C_HIGHLIGHT, "#3d3934"}, {C_MATCH, "#569e16"}},
-		{{NAME, "Sourlick"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#615953"}, {C_BG, "#2e2c2b"}, {C_HIGHLIGHT, "#3b3633"}, {C_MATCH, "#8ac27a"}},
-		{{NAME, "Laravel"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#615953"}, {C_BG, "#2e2c2b"}, {C_HIGHLIGHT, "#3b3633"}, {C_MATCH, "#fc6b0a"}},
-		{{NAME, "Azure"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#414d62"}, {C_BG, "#181d26"}, {C_HIGHLIGHT, "#33333c"}, {C_MATCH, "#52708b"}},
-		{{NAME, "Tron Contrast"}, {C_TITLE, "#aec2e0"}, {C_COMMENT, "#324357"}, {C_BG, "#07090b"}, {C_HIGHLIGHT, "#101419"}, {C_MATCH, "#ffffff"}},
-		{{NAME, "Stark"}, {C_TITLE, "#dedede"}, {C_COMMENT, "#615953"}, {C_BG, "#2e2c2b"}, {C_HIGHLIGHT, "#3b3633"}, {C_MATCH, "#f03113"}},
-		{{NAME, "Userscape"}, {C_TITLE, "#879bb0"}, {C_COMMENT, "#bbbbbb"}, {C_BG, "#f5f8fc"}, {C_HIGHLIGHT, "#eeeeee"}, {C_MATCH, "#355b8c"}},
-		{{NAME, "Carbonight Contrast"}, {C_TITLE, "#ffffff"}, {C_COMMENT, "#423f3d"}, {C_BG, "#000000"}, {C_HIGHLIGHT, "#151515"}, {C_MATCH, "#8c8c8c"}},
-		{{NAME, "Gloom Contrast"}, {C_TITLE, "#d8ebe5"}, {C_COMMENT, "#4f6e64"}, {C_BG, "#0f120f"}, {C_HIGHLIGHT, "#1b211c"}, {C_MATCH, "#ff5d38"}},
-		{{NAME, "Lavender"}, {C_TITLE, "#e0ceed"}, {C_COMMENT, "#614e6e"}, {C_BG, "#29222e"}, {C_HIGHLIGHT, "#3a2f42"}, {C_MATCH, "#b657ff"}},
-		{{NAME, "Solarflare"}, {C_TITLE, "#e3e2e0"}, {C_COMMENT, "#777777"}, {C_BG, "#222222"}, {C_HIGHLIGHT, "#282828"}, {C_MATCH, "#ff4e50"}},
-		{{NAME, "Turnip"}, {C_TITLE, "#ede0ce"}, {C_COMMENT, "#7a7267"}, {C_BG, "#1a1b1d"}, {C_HIGHLIGHT, "#222222"}, {C_MATCH, "#487d76"}}};
+constexpr Theme THEMES[] = { // generated from http://daylerees.github.io/
+		{"Default ", {0x111111, 0x999999, 0xffffff, 0xf8c291, 0x111111}},
+		{"Mellow Contrast", {0xf8f8f2, 0x7a7267, 0x0b0a09, 0x13110f, 0x1f8181}},
+		{"Legacy", {0xaec2e0, 0x324357, 0x14191f, 0x1b232c, 0xffffff}},
+		{"Slime Contrast", {0xffffff, 0x4f5a63, 0x0b0c0d, 0x131516, 0x6a9ec5}},
+		{"Peacock", {0xede0ce, 0x7a7267, 0x2b2a27, 0x403c37, 0xff5d38}},
+		{"Earthsong Light", {0x4d463e, 0xd6cab9, 0xffffff, 0xeeeeee, 0xdb784d}},
+		{"Zacks Contrast", {0xf0f0f0, 0x777777, 0x000000, 0x151515, 0xff6a38}},
+		{"Laravel Contrast", {0xffffff, 0x615953, 0x000000, 0x151515, 0xfc6b0a}},
+		{"Glowfish Contrast", {0x6ea240, 0x3c4e2d, 0x090b07, 0x12160d, 0xdb784d}},
+		{"Halflife", {0xcccccc, 0x555555, 0x222222, 0x282828, 0x7d8991}},
+		{"Mud", {0xffffff, 0xc3b8b7, 0x403635, 0x322a29, 0xff9787}},
+		{"Keen", {0xcccccc, 0x374c60, 0x111111, 0x222222, 0x8767b7}},
+		{"Patriot Contrast", {0xcad9e3, 0x515e66, 0x0d0e0f, 0x191b1c, 0x2e6fd9}},
+		{"Glowfish", {0x6ea240, 0x3c4e2d, 0x191f13, 0x222a1a, 0xdb784d}},
+		{"Tribal", {0xffffff, 0x4a4a54, 0x19191d, 0x33333c, 0x5f5582}},
+		{"Peel", {0xedebe6, 0x585146, 0x23201c, 0x403c37, 0xd3643b}},
+		{"FreshCut Contrast", {0xf8f8f2, 0x737b84, 0x000000, 0x151515, 0x00a8c6}},
+		{"Earthsong Contrast", {0xebd1b7, 0x7a7267, 0x12100f, 0x282521, 0xdb784d}},
+		{"Gloom", {0xd8ebe5, 0x4f6e64, 0x2a332b, 0x3c4d3e, 0xff5d38}},
+		{"Yule", {0xede0ce, 0x7a7267, 0x2b2a27, 0x52504b, 0xd63131}},
+		{"Darkside Contrast", {0xbababa, 0x494b4d, 0x000000, 0x151515, 0xe8341c}},
+		{"Mintchoc", {0xbababa, 0x564439, 0x2b221c, 0x3f322a, 0x008d62}},
+		{"Potpourri", {0xf8f8f2, 0x696363, 0x2e2b2c, 0x403c37, 0xed1153}},
+		{"Juicy", {0xe3e2e0, 0x777777, 0x222222, 0x282828, 0x3bc7b8}},
+		{"Snappy Light", {0x555555, 0xbbbbbb, 0xffffff, 0xeeeeee, 0xf66153}},
+		{"Goldfish Contrast", {0xf8f8f2, 0x505c63, 0x0c0d0e, 0x16181a, 0xfa6900}},
+		{"Kiwi", {0xedebe6, 0x354341, 0x161a19, 0x282f2d, 0x95c72a}},
+		{"Spearmint", {0x719692, 0x93c7c0, 0xe1f0ee, 0xceebe7, 0x25808a}},
+		{"Mud Contrast", {0xffffff, 0x524343, 0x0d0b0b, 0x171413, 0xf55239}},
+		{"Earthsong", {0xebd1b7, 0x7a7267, 0x36312c, 0x45403b, 0xdb784d}},
+		{"Revelation Contrast", {0xdedede, 0x7b726b, 0x0c0b0b, 0x1a1918, 0x617fa0}},
+		{"Github", {0x555555, 0xb8b6b1, 0xffffff, 0xeeeeee, 0x008080}},
+		{"Turnip Contrast", {0xede0ce, 0x7a7267, 0x080809, 0x1c1d1f, 0x487d76}},
+		{"Iceberg", {0xbdd6db, 0x537178, 0x323b3d, 0x3e4c4f, 0x2d8da1}},
+		{"Zacks", {0xf0f0f0, 0x777777, 0x222222, 0x333333, 0xff6a38}},
+		{"Snappy", {0xe3e2e0, 0x696969, 0x393939, 0x282828, 0xf66153}},
+		{"Slate", {0xebebf4, 0x515166, 0x19191f, 0x2a2a33, 0x89a7b1}},
+		{"Shrek", {0xffffff, 0x555555, 0x222222, 0x333333, 0x857a5e}},
+		{"Patriot", {0xcad9e3, 0x515e66, 0x2d3133, 0x40484d, 0x2e6fd9}},
+		{"Chocolate", {0xffffff, 0x795431, 0x150f08, 0x362715, 0xccb697}},
+		{"Peacock Contrast", {0xffffff, 0x555555, 0x0c0c0b, 0x151513, 0xff5d38}},
+		{"Super", {0xffffff, 0x465360, 0x15191d, 0x242b32, 0xd60257}},
+		{"Peacocks In Space", {0xdee3ec, 0x6e7a94, 0x2b303b, 0x272b34, 0xff5d38}},
+		{"Lavender Contrast", {0xe0ceed, 0x614e6e, 0x080709, 0x110e13, 0xb657ff}},
+		{"Arstotzka", {0xedebe6, 0x3f3a36, 0x211f1e, 0x292725, 0x516b6b}},
+		{"Slime", {0xffffff, 0x4f5a63, 0x292d30, 0x384147, 0x9fb3c2}},
+		{"Sourlick Contrast", {0xdedede, 0x615953, 0x060606, 0x171615, 0x8ac27a}},
+		{"Rainbow", {0xc7d0d9, 0x424c55, 0x16181a, 0x403c37, 0xef746f}},
+		{"Goldfish", {0xf8f8f2, 0x505c63, 0x2e3336, 0x465459, 0xfa6900}},
+		{"Snappy Contrast", {0xe3e2e0, 0x696969, 0x0c0c0c, 0x181818, 0xf66153}},
+		{"Revelation", {0xdedede, 0x7b726b, 0x2e2c2b, 0x3b3633, 0x617fa0}},
+		{"Frontier Contrast", {0xf8f8f2, 0x7a7267, 0x110f0e, 0x221f1c, 0xf23a3a}},
+		{"Stark Contrast", {0xdedede, 0x615953, 0x0b0a0a, 0x181716, 0xf03113}},
+		{"Darkside", {0xbababa, 0x494b4d, 0x222324, 0x303333, 0xe8341c}},
+		{"Solarflare Contrast", {0xe3e2e0, 0x777777, 0x000000, 0x151515, 0xff4e50}},
+		{"Frontier", {0xf8f8f2, 0x7a7267, 0x36312c, 0x45403b, 0xf23a3a}},
+		{"Tonic", {0xeeeeee, 0x4a5356, 0x2a2f31, 0x353b3e, 0xb8cd44}},
+		{"Pastel", {0xeeeeee, 0x444444, 0x222222, 0x333333, 0x04c4a5}},
+		{"Potpourri Contrast", {0xf8f8f2, 0x696363, 0x0d0c0c, 0x141313, 0xed1153}},
+		{"Tron", {0xaec2e0, 0x324357, 0x14191f, 0x1b232c, 0xffffff}},
+		{"Grunge", {0xf8f8f2, 0x5c634f, 0x31332c, 0x41453a, 0xf56991}},
+		{"Bold", {0xffffff, 0x534b4b, 0x2a2626, 0x393434, 0xf0624b}},
+		{"Keen Contrast", {0xffffff, 0x374c60, 0x000000, 0x151515, 0x8767b7}},
+		{"Crisp", {0xffffff, 0x574457, 0x221a22, 0x1c151c, 0x765478}},
+		{"Otakon", {0xf9f3f9, 0x515166, 0x171417, 0x332d33, 0xf6e6eb}},
+		{"Carbonight", {0xb0b0b0, 0x423f3d, 0x2e2c2b, 0x3b3633, 0x8c8c8c}},
+		{"FreshCut", {0xf8f8f2, 0x737b84, 0x2f3030, 0x383939, 0x00a8c6}},
+		{"Juicy Contrast", {0xe3e2e0, 0x777777, 0x000000, 0x151515, 0x3bc7b8}},
+		{"Box UK", {0x414f5c, 0xb8b6b1, 0xffffff, 0xeeeeee, 0x019d76}},
+		{"Grunge Contrast", {0xf8f8f2, 0x5c634f, 0x0c0c0a, 0x1b1c18, 0xf56991}},
+		{"Mellow", {0xf8f8f2, 0x7a7267, 0x36312c, 0x45403b, 0x1f8181}},
+		{"Halflife Contrast", {0xcccccc, 0x555555, 0x000000, 0x151515, 0x7d8991}},
+		{"Hyrule Contrast", {0xc0d5c1, 0x716d6a, 0x0c0c0c, 0x141413, 0x569e16}},
+		{"Iceberg Contrast", {0xbdd6db, 0x537178, 0x0b0e0e, 0x141718, 0x2d8da1}},
+		{"Piggy", {0xedebe6, 0x3f3236, 0x1c1618, 0x34282c, 0xfd6a5d}},
+		{"Hyrule", {0xc0d5c1, 0x716d6a, 0x2d2c2b, 0x3d3934, 0x569e16}},
+		{"Sourlick", {0xdedede, 0x615953, 0x2e2c2b, 0x3b3633, 0x8ac27a}},
+		{"Laravel", {0xdedede, 0x615953, 0x2e2c2b, 0x3b3633, 0xfc6b0a}},
+		{"Azure", {0xffffff, 0x414d62, 0x181d26, 0x33333c, 0x52708b}},
+		{"Tron Contrast", {0xaec2e0, 0x324357, 0x07090b, 0x101419, 0xffffff}},
+		{"Stark", {0xdedede, 0x615953, 0x2e2c2b, 0x3b3633, 0xf03113}},
+		{"Userscape", {0x879bb0, 0xbbbbbb, 0xf5f8fc, 0xeeeeee, 0x355b8c}},
+		{"Carbonight Contrast", {0xffffff, 0x423f3d, 0x000000, 0x151515, 0x8c8c8c}},
+		{"Gloom Contrast", {0xd8ebe5, 0x4f6e64, 0x0f120f, 0x1b211c, 0xff5d38}},
+		{"Lavender", {0xe0ceed, 0x614e6e, 0x29222e, 0x3a2f42, 0xb657ff}},
+		{"Solarflare", {0xe3e2e0, 0x777777, 0x222222, 0x282828, 0xff4e50}},
+		{"Turnip", {0xede0ce, 0x7a7267, 0x1a1b1d, 0x222222, 0x487d76}}};
+const int THEME_COUNT = std::size(THEMES);
 
 map<StyleAttribute, string> STYLE_OVERRIDE = {};
 
@@ -194,6 +282,8 @@ XftDraw *xftdraw;
 string query = "";
 string queryi = ""; // lower case
 int selected = 0;
+int scroll = 0; // index of the first visible result
+int ranked = 0; // number of results at the front of the list which are in sorted order
 int cursor = 0;
 bool cursorVisible = false;
 int width;
@@ -203,9 +293,56 @@ float scaleFactor = 1.0f;
 int inputHeight, rowHeight, textOffset, borderWidth, indent, commentSpace;
 XSetWindowAttributes attributes;
 vector<Application> applications;
+vector<Application> snapshot;
+vector<Result> entries; // every app and action which can be searched for, from the snapshot until applications are loaded,
+												// scored by launch count
+string snapshotData;		// snapshot file as it was read, to avoid rewriting it unchanged
+bool applicationsLoaded = false;
 vector<Result> results;
+vector<string> queryTokens;
+map<string, TokenMatches> tokenCache; // matches for the tokens of the last query, indexed like entries
 map<StyleAttribute, XftFont *> fonts;
-map<StyleAttribute, XftColor> colors;
+std::list<CachedFont> fontCache;										// most recently used first
+vector<std::pair<string, int>> fontPrefetch; // fonts for the neighbouring zoom levels, opened while idle
+std::pair<string, int> fontMatching;			 // the prefetched font being matched
+std::future<FcPattern *> fontMatch;				 // its match, found on another thread
+bool zoomed = false;												 // neighbouring zoom levels are only prefetched once the user has zoomed
+XftColor *colors; // colors of the current theme
+vector<Palette> palettes(THEME_COUNT);
+bool configChanged = false;
+int prefetchLevel = 0; // 0 = off, 1 = prefetch the selected app's binary, 2 = its shared libraries too
+string selectedCmd, prefetchedCmd;
+auto selectedAt = std::chrono::system_clock::now();
+std::mutex prefetchMutex;
+std::condition_variable prefetchWake;
+string prefetchCmd;	 // command for the prefetch thread to work on, guarded by prefetchMutex
+bool prefetchStop = false; // set as the launcher exits, guarded by prefetchMutex
+thread prefetchThread;
+std::atomic<int> prefetchGeneration = 0;
+vector<std::pair<long, long>> latencies; // time each key press was received and the results were painted
+Atom atoms[ATOM_COUNT];
+int monitorX, monitorY, monitorWidth;
+double dpi = 96.0;
+
+#ifdef COUNT_ROUND_TRIPS
+int roundTrips = 0;
+
+// every Xlib request which blocks waiting for the server goes through _XReply, so interposing it counts round trips
+extern "C" Status _XReply(Display *dpy, xReply *reply, int extra, Bool discard)
+{
+	static auto next = (Status(*)(Display *, xReply *, int, Bool))dlsym(RTLD_NEXT, "_XReply");
+	roundTrips++;
+	return next(dpy, reply, extra, discard);
+}
+
+void reportRoundTrips(const char *stage)
+{
+	std::cerr << "round trips (" << stage << "): " << roundTrips << "\n";
+	roundTrips = 0;
+}
+#else
+void reportRoundTrips(const char *stage) {}
+#endif
 
 string lowercase(const string &str)
 {
@@ -214,50 +351,185 @@ string lowercase(const string &str)
 	return out;
 };
 
-int renderText(const int x, const int y, string text, XftFont &font, const XftColor &color)
+int textWidth(string text, XftFont &font)
 {
-	XftDrawString8(xftdraw, &color, &font, x, y, (XftChar8 *)text.c_str(), text.length());
-	if (text.back() == ' ')
+	if (!text.empty() && text.back() == ' ')
 	{ // XftTextExtents appears to not count whitespace at the end of a string, so move it to the beginning
 		text = " " + text;
 	}
 	XGlyphInfo extents;
-	XftTextExtents8(display, &font, (FcChar8 *)text.c_str(), text.length(), &extents);
-	return x + extents.width;
+	XftTextExtents8(display, &font, (FcChar8 *)text.c_str(), text.length(), &extents); // glyph metrics are cached client side
+	return extents.width;
+}
+
+int renderText(const int x, const int y, const string &text, XftFont &font, const XftColor &color)
+{
+	XftDrawString8(xftdraw, &color, &font, x, y, (XftChar8 *)text.c_str(), text.length());
+	return x + textWidth(text, font);
+}
+
+bool compareResults(const Result &a, const Result &b)
+{
+	return b.score < a.score;
+}
+
+void rank(int count)
+{
+	// results are only sorted as far as has been needed for display - everything after `ranked` is unordered
+	// but scores no higher than those before it, so the sorted prefix can be extended as the user scrolls
+	count = std::min(std::max(count, ranked + MAX_ROWS), (int)results.size());
+	if (count > ranked)
+	{
+		partial_sort(results.begin() + ranked, results.begin() + count, results.end(), compareResults);
+		ranked = count;
+	}
+}
+
+const int WORD_BITS = sizeof(unsigned long) * CHAR_BIT;
+
+int keywordScore(const vector<Keyword> &keywords, const string &token)
+{
+	int i = 0;
+	for (const Keyword &keyword : keywords)
+	{
+		int matchIndex = keyword.word.find(token);
+		if (matchIndex != string::npos)
+		{
+			// score determined by:
+			// - apps whose names begin with the query string appear first
+			// - apps whose names or descriptions contain the query string then appear
+			return (100 - i) * keyword.weight * (matchIndex == 0 ? 10000 : 100);
+		}
+		i++;
+	}
+	return 0;
+}
+
+const TokenMatches &matchToken(const string &token)
+{
+	auto cached = tokenCache.find(token);
+	if (cached != tokenCache.end())
+	{
+		return cached->second;
+	}
+	// while typing, the previous query usually had this token minus its last letters - anything matching this
+	// token also matches that one, so only its matches need checking
+	const TokenMatches *previous = NULL;
+	for (int length = token.length() - 1; length > 0 && previous == NULL; length--)
+	{
+		auto prefix = tokenCache.find(token.substr(0, length));
+		if (prefix != tokenCache.end())
+		{
+			previous = &prefix->second;
+		}
+	}
+	const int entryCount = entries.size();
+	TokenMatches matches = {vector<unsigned long>((entryCount + WORD_BITS - 1) / WORD_BITS), vector<int>(entryCount)};
+	for (int w = 0; w < matches.bits.size(); w++)
+	{
+		unsigned long candidates = previous != NULL ? previous->bits[w] : ~0ul;
+		while (candidates != 0)
+		{
+			const int e = w * WORD_BITS + __builtin_ctzl(candidates);
+			candidates &= candidates - 1; // clear lowest bit
+			if (e >= entryCount)
+			{
+				break;
+			}
+			const Result &entry = entries[e];
+			int score;
+			if (entry.action == NULL)
+			{
+				score = keywordScore(entry.app->keywords, token);
+			}
+			else
+			{ // actions directly follow their app in entries, and the app's score has already been worked out
+				const int parent = e - (entry.action - entry.app->actions.data()) - 1;
+				score = std::max(keywordScore(entry.action->keywords, token), matches.scores[parent] / ACTION_PENALTY);
+			}
+			if (score > 0)
+			{
+				matches.bits[w] |= 1ul << (e % WORD_BITS);
+				matches.scores[e] = score;
+			}
+		}
+	}
+	return tokenCache[token] = std::move(matches);
 }
 
 void search()
 {
 	results = {};
-	for (Application &app : applications)
+	ranked = 0;
+	queryTokens = {};
+	stringstream ss(queryi);
+	string token;
+	while (getline(ss, token, ' '))
+	{
+		if (token != "")
+		{
+			queryTokens.push_back(token);
+		}
+	}
+	vector<const TokenMatches *> matches;
+	for (const string &token : queryTokens)
 	{
-		int score = 0;
-		int i = 0;
-		for (const Keyword &keyword : app.keywords)
+		matches.push_back(&matchToken(token));
+	}
+	if (!matches.empty())
+	{
+		vector<unsigned long> matched = matches[0]->bits; // entries which match every token
+		for (int t = 1; t < matches.size(); t++)
 		{
-			int matchIndex = keyword.word.find(queryi);
-			if (matchIndex != string::npos)
+			for (int w = 0; w < matched.size(); w++)
 			{
-				// score determined by:
-				// - apps whose names begin with the query string appear first
-				// - apps whose names or descriptions contain the query string then appear
-				// - apps which hav e been opened most frequently should be prioritised
-				score = (100 - i) * keyword.weight * (matchIndex == 0 ? 10000 : 100) + launches[app.id];
-				break;
+				matched[w] &= matches[t]->bits[w];
 			}
-			i++;
 		}
-		if (score > 0)
+		for (int w = 0; w < matched.size(); w++)
 		{
-			results.push_back({&app, score});
+			for (unsigned long bits = matched[w]; bits != 0; bits &= bits - 1)
+			{
+				const int e = w * WORD_BITS + __builtin_ctzl(bits);
+				Result result = entries[e]; // starts from the launch count, so frequently opened apps are prioritised
+				for (const TokenMatches *m : matches)
+				{
+					result.score += m->scores[e];
+				}
+				results.push_back(result);
+			}
 		}
 	}
-	sort(results.begin(), results.end(), [](const Result &a, const Result &b)
-			 { return b.score < a.score; });
-	if (results.size() > 10)
+	for (auto it = tokenCache.begin(); it != tokenCache.end();)
+	{ // keep only this query's tokens, for the next key press to build on
+		it = find(queryTokens.begin(), queryTokens.end(), it->first) == queryTokens.end() ? tokenCache.erase(it) : next(it);
+	}
+	rank(MAX_ROWS); // only the first page is sorted up front
+}
+
+void selectResult(int index)
+{
+	const int count = results.size();
+	if (count == 0)
+	{
+		selected = scroll = 0;
+		return;
+	}
+	selected = index < 0 ? count - 1 : index >= count ? 0 : index; // wrap around
+	rank(selected + 1);
+	if (selected < scroll)
 	{
-		results.resize(10); // limit to 10 results
+		scroll = selected;
 	}
+	if (selected >= scroll + MAX_ROWS)
+	{
+		scroll = selected - MAX_ROWS + 1;
+	}
+}
+
+int visibleRows()
+{
+	return std::min((int)results.size() - scroll, MAX_ROWS);
 }
 
 auto lastBlink = std::chrono::system_clock::now();
@@ -268,7 +540,7 @@ void renderTextInput(const bool showCursor)
 	char buffer[256];
 	time_t t = time(NULL);
 	strftime(buffer, sizeof(buffer), "%a %e %b %H:%M", localtime(&t));
-	int clockWidth = renderText(0, 0, buffer, *fonts[F_SMALLREGULAR], colors[C_COMMENT]);
+	int clockWidth = textWidth(buffer, *fonts[F_SMALLREGULAR]);
 	XClearArea(display, window, 0, 0, width, inputHeight, false);								 // clear input area
 	XSetForeground(display, gc, colors[C_HIGHLIGHT].pixel);											 // input border color
 	XSetLineAttributes(display, gc, borderWidth, LineSolid, CapButt, JoinRound); // input border style
@@ -276,7 +548,7 @@ void renderTextInput(const bool showCursor)
 	renderText(width - clockWidth - indent, ty * 0.92, buffer, *fonts[F_SMALLREGULAR], colors[C_TITLE]);
 	if (showCursor)
 	{
-		int cursorX = renderText(indent * 1.3, ty, query.substr(0, cursor), *fonts[F_LARGE], colors[C_BG]); // invisible text just to figure out cursor position
+		int cursorX = indent * 1.3 + textWidth(query.substr(0, cursor), *fonts[F_LARGE]);
 		XSetForeground(display, gc, showCursor ? colors[C_TITLE].pixel : colors[C_BG].pixel);								// cursor color
 		XFillRectangle(display, window, gc, cursorX, inputHeight / 4, 3, inputHeight / 2);									// cursor
 	}
@@ -294,9 +566,24 @@ void cursorBlink()
 	}
 }
 
+int findToken(const string &text, int &length)
+{ // position of the first query token in text, for highlighting
+	const string lower = lowercase(text);
+	for (const string &token : queryTokens)
+	{
+		const int i = lower.find(token);
+		if (i != string::npos)
+		{
+			length = token.length();
+			return i;
+		}
+	}
+	return -1;
+}
+
 void renderResults()
 {
-	int resultCount = results.size();
+	int resultCount = visibleRows();
 
 	XClearArea(display, window, 0, inputHeight, width, resultCount * rowHeight, false);							 // clear results area
 	XSetForeground(display, gc, colors[C_HIGHLIGHT].pixel);																					 // results border color
@@ -305,13 +592,16 @@ void renderResults()
 
 	for (int i = 0; i < resultCount; i++)
 	{
-		const Result result = results[i];
-		const int namei = lowercase(result.app->name).find(queryi);
-		const int commenti = lowercase(result.app->comment).find(queryi);
+		const Result result = results[scroll + i];
+		int nameLength, commentLength;
+		const string &name = result.name();
+		const string &comment = result.comment();
+		const int namei = findToken(name, nameLength);
+		const int commenti = findToken(comment, commentLength);
 		const int y = inputHeight + i * rowHeight;
 		int x = indent;
 
-		if (i == selected)
+		if (scroll + i == selected)
 		{
 			XSetForeground(display, gc, colors[C_HIGHLIGHT].pixel);
 			XFillRectangle(display, window, gc, 0, y, width, rowHeight);
@@ -319,32 +609,41 @@ void renderResults()
 
 		if (namei == string::npos)
 		{
-			x = renderText(x, y + textOffset, result.app->name.c_str(), *fonts[F_REGULAR], colors[C_TITLE]);
+			x = renderText(x, y + textOffset, name.c_str(), *fonts[F_REGULAR], colors[C_TITLE]);
 		}
 		else
 		{
-			string str = result.app->name.substr(0, namei);
+			string str = name.substr(0, namei);
 			x = renderText(x, y + textOffset, str.c_str(), *fonts[F_REGULAR], colors[C_TITLE]);
-			str = result.app->name.substr(namei, query.length());
+			str = name.substr(namei, nameLength);
 			x = renderText(x, y + textOffset, str.c_str(), *fonts[F_BOLD], colors[C_MATCH]);
-			str = result.app->name.substr(namei + query.length());
+			str = name.substr(namei + nameLength);
 			x = renderText(x, y + textOffset, str.c_str(), *fonts[F_REGULAR], colors[C_TITLE]);
 		}
 
 		if (commenti == string::npos)
 		{
-			renderText(x + commentSpace, y + textOffset, result.app->comment.c_str(), *fonts[F_SMALLREGULAR], colors[C_COMMENT]);
+			renderText(x + commentSpace, y + textOffset, comment.c_str(), *fonts[F_SMALLREGULAR], colors[C_COMMENT]);
 		}
 		else
 		{
-			string str = result.app->comment.substr(0, commenti);
+			string str = comment.substr(0, commenti);
 			x = renderText(x + commentSpace, y + textOffset, str.c_str(), *fonts[F_SMALLREGULAR], colors[C_COMMENT]);
-			str = result.app->comment.substr(commenti, query.length());
+			str = comment.substr(commenti, commentLength);
 			x = renderText(x, y + textOffset, str.c_str(), *fonts[F_SMALLBOLD], colors[C_COMMENT]);
-			str = result.app->comment.substr(commenti + query.length());
+			str = comment.substr(commenti + commentLength);
 			renderText(x, y + textOffset, str.c_str(), *fonts[F_SMALLREGULAR], colors[C_COMMENT]);
 		}
 	}
+
+	if (results.size() > MAX_ROWS)
+	{ // scrollbar, drawn over the rows and in a color that shows on the selected row too
+		const int height = resultCount * rowHeight;
+		const int barHeight = std::max(height * MAX_ROWS / (int)results.size(), borderWidth * 2);
+		const int barY = inputHeight + (long)(height - barHeight) * scroll / (results.size() - MAX_ROWS);
+		XSetForeground(display, gc, colors[C_COMMENT].pixel);
+		XFillRectangle(display, window, gc, width - borderWidth * 2, barY, borderWidth * 2, barHeight);
+	}
 }
 
 void readConfig()
@@ -373,17 +672,19 @@ void readConfig()
 		{
 			baseWidth = stof(val);
 		}
+		else if (key == "prefetch")
+		{
+			prefetchLevel = stoi(val);
+		}
 		else if (key == "theme")
 		{
-			int j = 0;
-			for (auto &t : THEMES)
+			for (int j = 0; j < THEME_COUNT; j++)
 			{
-				if (t[NAME] == val)
+				if (THEMES[j].name == val)
 				{
 					theme = j;
 					break;
 				}
-				j++;
 			}
 		}
 		else if (key.find("/") == string::npos)
@@ -409,7 +710,7 @@ void writeConfig()
 	ofstream outfile;
 	outfile.open(CONFIG);
 	outfile << "[Style]\n";
-	outfile << "theme=" << THEMES[theme][NAME] << "\n";
+	outfile << "theme=" << THEMES[theme].name << "\n";
 	outfile << "scale=" << scaleFactor << "\n";
 	outfile << "width=" << baseWidth << "\n";
 	for (const auto &[type, attr] : STYLE_ATTRIBUTES)
@@ -419,6 +720,8 @@ void writeConfig()
 			outfile << STYLE_ATTRIBUTES[type] << "=" << STYLE_OVERRIDE[type] << "\n";
 		}
 	}
+	outfile << "\n[Launch]\n";
+	outfile << "prefetch=" << prefetchLevel << "\n";
 	outfile << "\n[Launches]\n";
 
 	for (const auto &[appid, count] : launches)
@@ -429,6 +732,15 @@ void writeConfig()
 		}
 	}
 	outfile.close();
+	configChanged = false;
+}
+
+void saveConfig()
+{ // style changes are saved once on the way out rather than on every key press
+	if (configChanged)
+	{
+		writeConfig();
+	}
 }
 
 vector<Application> getApplications()
@@ -447,8 +759,36 @@ vector<Application> getApplications()
 			app.id = entry.path();
 			ifstream infile(app.id);
 			string line, keywords;
+			bool inEntry = true; // whether the current group is [Desktop Entry] rather than an action
 			while (getline(infile, line))
 			{
+				if (line.find("[") == 0)
+				{
+					inEntry = line.find("[Desktop Entry]") == 0;
+					if (line.find("[Desktop Action ") == 0)
+					{
+						const string key = line.substr(16, line.find("]") - 16);
+						app.actions.push_back({key});
+					}
+					else if (!inEntry)
+					{ // ignore any other groups
+						app.actions.push_back({});
+					}
+					continue;
+				}
+				if (!inEntry)
+				{
+					Action &action = app.actions.back();
+					if (action.name == "" && line.find("Name=") == 0)
+					{
+						action.name = line.substr(5);
+					}
+					if (action.cmd == "" && line.find("Exec=") == 0)
+					{
+						action.cmd = line.substr(5);
+					}
+					continue;
+				}
 				if (app.name == "" && line.find("Name=") == 0)
 				{
 					app.name = line.substr(5);
@@ -490,59 +830,377 @@ vector<Application> getApplications()
 				app.keywords.push_back({word, 1});
 			}
 
-			applications.push_back(app);
+			// drop other groups and incomplete actions
+			app.actions.erase(remove_if(app.actions.begin(), app.actions.end(), [](const Action &action)
+																	{ return action.key == "" || action.name == "" || action.cmd == ""; }),
+												app.actions.end());
+			for (Action &action : app.actions)
+			{ // an action is found by its own name, or by its app's keywords
+				ss = stringstream(lowercase(action.name));
+				while (getline(ss, word, ' '))
+				{
+					action.keywords.push_back({word, 1000});
+				}
+			}
+
+			applications.push_back(std::move(app));
 		}
 	}
 	return applications;
 }
 
-void setProperty(const char *property, const char *value)
+Result entry(Application *app, const Action *action = NULL)
+{ // an entry's score is its launch count, looked up once here so that searching never has to build its id
+	Result result = {app, 0, action};
+	const auto it = launches.find(result.id());
+	result.score = it != launches.end() ? it->second : 0;
+	return result;
+}
+
+vector<Result> frecent()
+{
+	vector<Result> top;
+	for (const Result &entry : entries)
+	{
+		if (entry.score > 0)
+		{
+			top.push_back(entry);
+		}
+	}
+	const int count = std::min((int)top.size(), SNAPSHOT_SIZE);
+	partial_sort(top.begin(), top.begin() + count, top.end(), compareResults);
+	top.resize(count);
+	return top;
+}
+
+void readSnapshot()
+{
+	const int fd = open(SNAPSHOT.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0)
+	{
+		return;
+	}
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return;
+	}
+	snapshotData.resize(info.st_size);
+	snapshotData.resize(std::max(read(fd, &snapshotData[0], info.st_size), (ssize_t)0)); // the whole file in one read
+	close(fd);
+	// one app or action per line: desktop file, action key (empty for apps), modification time, name, comment, command
+	// (tab separated)
+	for (int start = 0, end; (end = snapshotData.find('\n', start)) != string::npos; start = end + 1)
+	{
+		vector<string> fields;
+		for (int i = start, j; i <= end; i = j + 1)
+		{
+			j = snapshotData.find_first_of("\t\n", i);
+			fields.push_back(snapshotData.substr(i, j - i));
+		}
+		if (fields.size() != 6 || stat(fields[0].c_str(), &info) != 0 || std::to_string(info.st_mtime) != fields[2])
+		{ // the desktop file has changed or been removed since the snapshot was taken
+			continue;
+		}
+		if (fields[1] == "")
+		{
+			snapshot.push_back({fields[0], fields[3], "", fields[4], fields[5]});
+		}
+		else
+		{ // an action is stored with its app's name as the comment, and given an app of its own to belong to
+			snapshot.push_back({fields[0], fields[4]});
+			snapshot.back().actions.push_back({fields[1], fields[3], fields[5]});
+		}
+	}
+	for (Application &app : snapshot)
+	{
+		entries.push_back(entry(&app, app.actions.empty() ? NULL : &app.actions[0]));
+	}
+}
+
+void writeSnapshot(const vector<Result> &top)
+{
+	string data;
+	for (const Result &result : top)
+	{
+		struct stat info;
+		if (stat(result.app->id.c_str(), &info) == 0)
+		{
+			data += result.app->id + '\t' + (result.action ? result.action->key : "") + '\t' + std::to_string(info.st_mtime) + '\t' +
+							result.name() + '\t' + result.comment() + '\t' + result.cmd() + '\n';
+		}
+	}
+	if (data == snapshotData)
+	{
+		return;
+	}
+	std::error_code error;
+	fs::create_directories(CACHE_DIR, error);
+	ofstream outfile;
+	outfile.open(SNAPSHOT + ".tmp");
+	outfile << data;
+	outfile.close();
+	rename((SNAPSHOT + ".tmp").c_str(), SNAPSHOT.c_str()); // replace atomically so a reader never sees half a file
+	snapshotData = data;
+}
+
+void saveSnapshot()
+{ // written on the way out, like the config, so the UI thread never waits on it
+	writeSnapshot(frecent());
+}
+
+void showFrecent()
+{ // with no query, list the most launched apps - from the snapshot until the full list has loaded
+	results = frecent();
+	queryTokens = {};
+	ranked = results.size();
+}
+
+void setProperty(const AtomName property, const vector<AtomName> &values)
 {
-	const Atom propertyAtom = XInternAtom(display, property, False);
-	const long valueAtom = XInternAtom(display, value, False);
-	XChangeProperty(display, window, propertyAtom, XA_ATOM, 32, PropModeReplace, (unsigned char *)&valueAtom, 1);
+	vector<long> valueAtoms;
+	for (const AtomName value : values)
+	{
+		valueAtoms.push_back(atoms[value]);
+	}
+	XChangeProperty(display, window, atoms[property], XA_ATOM, 32, PropModeReplace, (unsigned char *)valueAtoms.data(), valueAtoms.size());
+}
+
+vector<string> parseArgs(const string &cmd)
+{
+	stringstream ss(cmd);
+	vector<string> args;
+	string arg;
+	while (getline(ss, arg, ' '))
+	{
+		if (arg.find('%') != 0) // skip field codes such as %U
+		{
+			args.push_back(arg);
+		}
+	}
+	return args;
 }
 
-void launch(Application &app)
+void launch(const Result &result)
 {
 	const int pid = fork(); // this duplicates the launcher process
 	if (pid == 0)
 	{ // if this is the child process, replace it with the application
 		chdir(HOME_DIR.c_str());
-		stringstream ss(app.cmd);
-		vector<char *> args;
-		string arg;
-		while (getline(ss, arg, ' '))
+		vector<string> args = parseArgs(result.cmd());
+		vector<char *> command;
+		for (string &arg : args)
 		{
-			if (arg.find('%') != 0)
-			{
-				string *a = new string(arg);
-				args.push_back(const_cast<char *>(a->c_str()));
-			}
+			command.push_back(arg.data());
 		}
-		args.push_back(NULL);
-		char **command = &args[0];
-		execvp(command[0], command);
+		command.push_back(NULL);
+		execvp(command[0], &command[0]);
+		_exit(127); // exec failed - don't run the launcher's exit handlers, which would rewrite the config
 	}
 	else
 	{
-		launches[app.id]++;
-		writeConfig();
+		launches[result.id()]++;
+		for (Result &entry : entries)
+		{ // entries keep their own count, which the snapshot is written from
+			if (entry.app == result.app && entry.action == result.action)
+			{
+				entry.score++;
+			}
+		}
+		writeConfig(); // the snapshot is then updated by saveSnapshot() as the launcher exits
 	}
 	exit(0);
 }
 
+string findExecutable(const string &name)
+{
+	if (name.find('/') != string::npos)
+	{
+		return name;
+	}
+	stringstream ss(getenv("PATH") != NULL ? getenv("PATH") : "/usr/local/bin:/usr/bin:/bin");
+	string dir;
+	while (getline(ss, dir, ':'))
+	{
+		const string path = dir + "/" + name;
+		if (access(path.c_str(), X_OK) == 0)
+		{
+			return path;
+		}
+	}
+	return "";
+}
+
+vector<string> findLibraries(const string &path)
+{ // reads the DT_NEEDED entries from the dynamic section of an ELF file
+	vector<string> libraries;
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return libraries;
+	}
+	ElfW(Ehdr) header;
+	if (pread(fd, &header, sizeof header, 0) != sizeof header || memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+			header.e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32) || header.e_phentsize != sizeof(ElfW(Phdr)))
+	{ // not an ELF file for this architecture (e.g. a script)
+		close(fd);
+		return libraries;
+	}
+	vector<ElfW(Phdr)> segments(header.e_phnum);
+	pread(fd, segments.data(), segments.size() * sizeof(ElfW(Phdr)), header.e_phoff);
+	vector<ElfW(Dyn)> dynamic;
+	for (const ElfW(Phdr) &segment : segments)
+	{
+		if (segment.p_type == PT_DYNAMIC && segment.p_filesz < 65536)
+		{
+			dynamic.resize(segment.p_filesz / sizeof(ElfW(Dyn)));
+			pread(fd, dynamic.data(), dynamic.size() * sizeof(ElfW(Dyn)), segment.p_offset);
+		}
+	}
+	long stringTable = -1;
+	for (const ElfW(Dyn) &entry : dynamic)
+	{
+		if (entry.d_tag == DT_STRTAB)
+		{
+			for (const ElfW(Phdr) &segment : segments)
+			{ // the string table is given as an address in memory, so find where that is loaded from
+				if (segment.p_type == PT_LOAD && entry.d_un.d_ptr >= segment.p_vaddr && entry.d_un.d_ptr < segment.p_vaddr + segment.p_filesz)
+				{
+					stringTable = entry.d_un.d_ptr - segment.p_vaddr + segment.p_offset;
+				}
+			}
+		}
+	}
+	for (const ElfW(Dyn) &entry : dynamic)
+	{
+		if (entry.d_tag == DT_NEEDED && stringTable >= 0 && libraries.size() < PREFETCH_MAX_LIBRARIES)
+		{
+			char name[256] = {0};
+			pread(fd, name, sizeof name - 1, stringTable + entry.d_un.d_val);
+			for (const string &dir : LIBRARY_DIRS)
+			{
+				const string library = dir + "/" + name;
+				if (access(library.c_str(), R_OK) == 0)
+				{
+					libraries.push_back(library);
+					break;
+				}
+			}
+		}
+	}
+	close(fd);
+	return libraries;
+}
+
+long prefetchFile(const string &path, const long budget)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0)
+	{
+		return 0;
+	}
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return 0;
+	}
+	const long length = std::min((long)info.st_size, budget);
+	posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED); // queues the reads without waiting for them
+	close(fd);
+	return length;
+}
+
+void prefetchWorker()
+{ // runs on its own thread so the disk is never touched from the UI thread
+	long totalBudget = PREFETCH_TOTAL_BUDGET;
+	while (totalBudget > 0)
+	{
+		std::unique_lock<std::mutex> lock(prefetchMutex);
+		prefetchWake.wait(lock, []
+											{ return prefetchCmd != "" || prefetchStop; });
+		if (prefetchStop)
+		{
+			return;
+		}
+		const string cmd = prefetchCmd;
+		const int generation = prefetchGeneration;
+		prefetchCmd = "";
+		lock.unlock();
+
+		const vector<string> args = parseArgs(cmd);
+		const string binary = args.empty() ? "" : findExecutable(args[0]);
+		if (binary == "")
+		{
+			continue;
+		}
+		vector<string> files = {binary};
+		if (prefetchLevel > 1)
+		{
+			for (const string &library : findLibraries(binary))
+			{
+				files.push_back(library);
+			}
+		}
+		long budget = std::min(PREFETCH_BUDGET, totalBudget);
+		for (const string &file : files)
+		{
+			if (budget <= 0 || generation != prefetchGeneration)
+			{ // out of budget, or the selection has moved on (which is also how exiting interrupts this)
+				break;
+			}
+			const long length = prefetchFile(file, budget);
+			budget -= length;
+			totalBudget -= length;
+		}
+	}
+}
+
+void stopPrefetch()
+{ // the thread has to finish before exit destroys the globals it uses
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchStop = true;
+		prefetchGeneration++;
+	}
+	prefetchWake.notify_one();
+	prefetchThread.join();
+}
+
+void updatePrefetch()
+{ // once the selection has settled, have the prefetch thread read the selected app into the page cache
+	if (prefetchLevel == 0 || results.empty())
+	{
+		return;
+	}
+	const string cmd = results[selected].cmd();
+	const auto now = std::chrono::system_clock::now();
+	if (cmd != selectedCmd)
+	{
+		selectedCmd = cmd;
+		selectedAt = now;
+	}
+	else if (cmd != prefetchedCmd && now - selectedAt > (std::chrono::milliseconds)PREFETCH_DELAY)
+	{
+		prefetchedCmd = cmd;
+		{
+			std::lock_guard<std::mutex> lock(prefetchMutex);
+			prefetchCmd = cmd;
+			prefetchGeneration++;
+		}
+		prefetchWake.notify_one();
+	}
+}
+
 Visual *visual;
 Colormap colormap;
 int windowX, windowY;
+int shownWidth, shownHeight; // current size of the window
 
 map<StyleAttribute, string> getStyle()
 {
 	map<StyleAttribute, string> style = STYLE_DEFAULTS;
-	for (const auto &[type, val] : THEMES[theme])
-	{
-		style[type] = val;
-	}
 	for (const auto &[type, val] : STYLE_OVERRIDE)
 	{
 		style[type] = val;
@@ -550,79 +1208,195 @@ map<StyleAttribute, string> getStyle()
 	return style;
 };
 
-void updateFonts()
+int fontSize(const string &pattern, const float scale)
 {
-	map<StyleAttribute, string> style = getStyle();
-	for (const StyleAttribute c : FONTS)
+	int i = pattern.find("-");
+	if (i <= 0)
 	{
-		if (fonts.find(c) != fonts.end())
+		return 0; // no size given
+	}
+	int j = pattern.find(":");
+	string number = pattern.substr(i + 1, j > 0 ? j - i : string::npos);
+	return stoi(number) * scale;
+}
+
+void evictFont(const bool prefetched)
+{ // closes the least recently used font of the given kind - fonts in use are always near the front
+	for (auto it = fontCache.rbegin(); it != fontCache.rend(); it++)
+	{
+		if (it->prefetched == prefetched)
 		{
-			XftFontClose(display, fonts[c]);
+			XftFontClose(display, it->font);
+			fontCache.erase(next(it).base());
+			return;
 		}
-		string name = style[c];
-		int i = name.find("-");
-		if (i > 0)
+	}
+}
+
+string fontName(const string &pattern, const int size)
+{
+	string name = pattern;
+	int i = name.find("-");
+	if (i > 0)
+	{
+		int j = name.find(":");
+		string before = name.substr(0, i + 1);
+		string after = j > 0 ? name.substr(j, string::npos) : "";
+		name = before + std::to_string(size) + after;
+	}
+	return name;
+}
+
+XftFont *openFont(const string &pattern, const int size, const bool prefetch = false, FcPattern *match = NULL)
+{ // match is an already matched pattern to open instead of matching the name again, and is consumed
+	for (auto it = fontCache.begin(); it != fontCache.end(); it++)
+	{
+		if (it->pattern == pattern && it->size == size)
 		{
-			int j = name.find(":");
-			string before = name.substr(0, i + 1);
-			string number = name.substr(i + 1, j > 0 ? j - i : string::npos);
-			string after = j > 0 ? name.substr(j, string::npos) : "";
-			int size = stoi(number) * scaleFactor;
-			name = before + std::to_string(size) + after;
+			it->prefetched = it->prefetched && prefetch;
+			fontCache.splice(fontCache.begin(), fontCache, it); // move to front
+			if (match)
+			{
+				FcPatternDestroy(match);
+			}
+			return it->font;
 		}
-		fonts[c] = XftFontOpenName(display, screen, name.c_str());
 	}
+	const int count = count_if(fontCache.begin(), fontCache.end(), [prefetch](const CachedFont &f)
+														 { return f.prefetched == prefetch; });
+	if (count >= (prefetch ? FONT_PREFETCH_SIZE : FONT_CACHE_SIZE))
+	{
+		evictFont(prefetch);
+	}
+	XftFont *font = match ? XftFontOpenPattern(display, match) : XftFontOpenName(display, screen, fontName(pattern, size).c_str());
+	fontCache.push_front({pattern, size, font, prefetch});
+	return font;
 }
 
-void updateStyle()
+void updateFonts()
 {
 	map<StyleAttribute, string> style = getStyle();
-
-	for (const StyleAttribute c : COLORS)
+	fontPrefetch = {};
+	for (const StyleAttribute c : FONTS)
 	{
-		unsigned short r = stol(style[c].substr(1, 2), nullptr, 16) * 256;
-		unsigned short g = stol(style[c].substr(3, 2), nullptr, 16) * 256;
-		unsigned short b = stol(style[c].substr(5, 2), nullptr, 16) * 256;
-		XRenderColor xrcolor = {.red = r, .green = g, .blue = b, .alpha = 255 * 256};
-		XftColorAllocValue(display, visual, colormap, &xrcolor, &colors[c]);
+		fonts[c] = openFont(style[c], fontSize(style[c], scaleFactor));
+		for (const float scale : {scaleFactor - SCALE_STEP, scaleFactor + SCALE_STEP})
+		{
+			if (zoomed && scale >= 0.1f && scale <= 6.0f)
+			{
+				fontPrefetch.push_back({style[c], fontSize(style[c], scale)});
+			}
+		}
 	}
+}
 
-	updateFonts();
+void prefetchFont()
+{ // fontconfig's match is the slow part of opening a font, so it runs on another thread and only opening the matched
+	// font is left to the UI thread, one font at a time between events
+	if (fontMatch.valid())
+	{
+		if (fontMatch.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return;
+		}
+		FcPattern *match = fontMatch.get();
+		if (match && XPending(display) == 0)
+		{
+			openFont(fontMatching.first, fontMatching.second, true, match);
+		}
+		else if (match)
+		{ // a key press is waiting, it goes first and the font will be matched again later
+			fontPrefetch.push_back(fontMatching);
+			FcPatternDestroy(match);
+		}
+	}
+	while (!fontPrefetch.empty() && !fontMatch.valid())
+	{
+		fontMatching = fontPrefetch.back();
+		fontPrefetch.pop_back();
+		const auto &[pattern, size] = fontMatching;
+		if (any_of(fontCache.begin(), fontCache.end(), [&](const CachedFont &f)
+							 { return f.pattern == pattern && f.size == size; }))
+		{
+			continue;
+		}
+		FcPattern *request = FcNameParse((const FcChar8 *)fontName(pattern, size).c_str());
+		FcConfigSubstitute(NULL, request, FcMatchPattern); // the same substitutions XftFontOpenName makes
+		XftDefaultSubstitute(display, screen, request);
+		fontMatch = std::async(std::launch::async, [request]
+													 {
+			FcResult result;
+			FcPattern *match = FcFontMatch(NULL, request, &result);
+			FcPatternDestroy(request);
+			return match; });
+	}
+}
 
+void updateStyle()
+{ // colors are allocated the first time a theme is used and kept, so switching theme is just a pointer swap
+	Palette &palette = palettes[theme];
+	if (!palette.allocated)
+	{
+		for (int i = 0; i < std::size(COLORS); i++)
+		{
+			const StyleAttribute c = COLORS[i];
+			unsigned int rgb = THEMES[theme].colors[i];
+			if (STYLE_OVERRIDE.find(c) != STYLE_OVERRIDE.end())
+			{
+				rgb = stol(STYLE_OVERRIDE[c].substr(1, 6), nullptr, 16);
+			}
+			XRenderColor xrcolor = {.red = (unsigned short)((rgb >> 16 & 0xff) * 256),
+															.green = (unsigned short)((rgb >> 8 & 0xff) * 256),
+															.blue = (unsigned short)((rgb & 0xff) * 256),
+															.alpha = 255 * 256};
+			XftColorAllocValue(display, visual, colormap, &xrcolor, &palette.colors[c]);
+		}
+		palette.allocated = true;
+	}
+	colors = palette.colors;
 	XSetWindowBackground(display, window, colors[C_BG].pixel);
 }
 
-void updateScale()
+void locateMonitor()
 {
 	int x, y, throwaway;
 	unsigned m;
 	Window w;
 	XQueryPointer(display, root, &w, &w, &x, &y, &throwaway, &throwaway, &m); // get mouse position
-	XRRScreenResources *xrrr = XRRGetScreenResources(display, root);
-	XRRCrtcInfo *monitor;
-	int i;
-	int ncrtc = xrrr->ncrtc;
-	for (i = 0; i < ncrtc; ++i)
-	{
-		monitor = XRRGetCrtcInfo(display, xrrr, xrrr->crtcs[i]);
-		if (x >= monitor->x && x < monitor->x + monitor->width &&
-				y >= monitor->y && y < monitor->y + monitor->width)
-		{ // find monitor which mouse in on
+	XRRScreenResources *xrrr = XRRGetScreenResourcesCurrent(display, root);		 // current config, without reprobing outputs
+	for (int i = 0; i < xrrr->ncrtc; ++i)
+	{
+		XRRCrtcInfo *monitor = XRRGetCrtcInfo(display, xrrr, xrrr->crtcs[i]);
+		const bool found = x >= monitor->x && x < monitor->x + (int)monitor->width &&
+											 y >= monitor->y && y < monitor->y + (int)monitor->height;
+		if (found || i == 0)
+		{ // find monitor which mouse in on (falling back to the first one)
+			monitorX = monitor->x;
+			monitorY = monitor->y;
+			monitorWidth = monitor->width;
+		}
+		XRRFreeCrtcInfo(monitor);
+		if (found)
+		{
 			break;
 		}
 	}
+	XRRFreeScreenResources(xrrr);
 	char *resourceString = XResourceManagerString(display);
 	XrmInitialize(); /* Need to initialize the DB before calling Xrm* functions */
 	XrmDatabase db = XrmGetStringDatabase(resourceString);
 	char *type = NULL;
 	XrmValue value;
-	double dpi = 96.0;
 	if (resourceString &&
 			XrmGetResource(db, "Xft.dpi", "String", &type, &value) == True &&
 			value.addr)
 	{
 		dpi = atof(value.addr);
 	}
+}
+
+void updateScale()
+{ // uses only the monitor geometry found at startup so that rescaling makes no round trips to the server
 	float dpiScaleFactor = dpi / BASE_DPI;
 	if (scaleFactor < 0.1)
 	{
@@ -635,20 +1409,20 @@ void updateScale()
 	borderWidth = sf * BORDER_WIDTH;
 	indent = sf * INDENT;
 	commentSpace = sf * COMMENT_SPACE;
-	width = sf * monitor->width * baseWidth;
+	width = sf * monitorWidth * baseWidth;
 	if (width < 200)
 	{
-		if (monitor->width > 210)
+		if (monitorWidth > 210)
 		{
 			width = 200;
 		}
 		else
 		{
-			width = monitor->width - 10;
+			width = monitorWidth - 10;
 		}
 	}
-	windowX = monitor->x + monitor->width / 2 - width / 2;
-	windowY = monitor->y + 200;
+	windowX = monitorX + monitorWidth / 2 - width / 2;
+	windowY = monitorY + 200;
 	updateFonts();
 }
 
@@ -665,13 +1439,22 @@ void onKeyPress(XEvent &event)
 		exit(0);
 		break;
 	case XK_Return:
-		launch(*results[selected].app);
+		if (!results.empty())
+		{
+			launch(results[selected]);
+		}
 		break;
 	case XK_Up:
-		selected = selected > 0 ? selected - 1 : results.size() - 1;
+		selectResult(selected - 1);
 		break;
 	case XK_Down:
-		selected = selected < results.size() - 1 ? selected + 1 : 0;
+		selectResult(selected + 1);
+		break;
+	case XK_Page_Up: // page up and down stop at the ends of the list rather than wrapping
+		selectResult(std::max(selected - MAX_ROWS, 0));
+		break;
+	case XK_Page_Down:
+		selectResult(std::min(selected + MAX_ROWS, (int)results.size() - 1));
 		break;
 	case XK_Left:
 		cursor = cursor > 0 ? cursor - 1 : 0;
@@ -710,18 +1493,19 @@ void onKeyPress(XEvent &event)
 	case XK_F5:
 		if (keysym == XK_F4)
 		{
-			theme = theme > 0 ? theme - 1 : THEMES.size() - 1;
+			theme = theme > 0 ? theme - 1 : THEME_COUNT - 1;
 		}
 		else
 		{
-			theme = theme < THEMES.size() - 1 ? theme + 1 : 0;
+			theme = theme < THEME_COUNT - 1 ? theme + 1 : 0;
 		}
 		updateStyle();
-		writeConfig();
+		configChanged = true;
 		break;
 	case XK_F6: // F6 and F7 for scaling/zoom
 	case XK_F7:
-		scaleFactor += keysym == XK_F6 ? -0.1f : 0.1f;
+		scaleFactor += keysym == XK_F6 ? -SCALE_STEP : SCALE_STEP;
+		zoomed = true;
 		if (scaleFactor > 6.0f)
 		{
 			scaleFactor = 6.0f;
@@ -731,7 +1515,7 @@ void onKeyPress(XEvent &event)
 			scaleFactor = 0.1f;
 		}
 		updateScale();
-		writeConfig();
+		configChanged = true;
 		break;
 	case XK_F8: // F8 and F9 for width
 	case XK_F9:
@@ -745,7 +1529,7 @@ void onKeyPress(XEvent &event)
 			baseWidth = 0.05f;
 		}
 		updateScale();
-		writeConfig();
+		configChanged = true;
 		break;
 	default:
 		if (textlength == 1 && !ctrl)
@@ -757,10 +1541,68 @@ void onKeyPress(XEvent &event)
 	queryi = lowercase(query);
 }
 
+long monotonicTime()
+{ // nanoseconds on CLOCK_MONOTONIC, so times can be compared with other processes
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void writeLatencies()
+{
+	ofstream outfile;
+	outfile.open(LATENCY_LOG);
+	for (const auto &[received, painted] : latencies)
+	{
+		outfile << received << " " << painted << "\n";
+	}
+	outfile.close();
+}
+
+void loadApplications(vector<Application> loaded)
+{
+	applications = std::move(loaded);
+	applicationsLoaded = true;
+	entries = {};
+	for (Application &app : applications)
+	{ // each app is followed by its actions
+		entries.push_back(entry(&app));
+		for (const Action &action : app.actions)
+		{
+			entries.push_back(entry(&app, &action));
+		}
+	}
+	tokenCache = {}; // bitsets are indexed by position in entries
+}
+
+void render()
+{
+	const int height = inputHeight + visibleRows() * rowHeight;
+	if (width != shownWidth || height != shownHeight)
+	{ // only resize the window when the number of rows or the scale changes
+		shownWidth = width;
+		shownHeight = height;
+		XMoveResizeWindow(display, window, windowX, windowY, width, height);
+	}
+	renderTextInput(true);
+	renderResults();
+}
+
 int main()
 {
 	auto awaitApps = async(getApplications); // prepare list of apps in the background
 	readConfig();
+	atexit(saveConfig);
+	if (LATENCY_LOG)
+	{
+		atexit(writeLatencies);
+	}
+	readSnapshot();
+	atexit(saveSnapshot); // keeps the snapshot in step with the desktop files and launch counts
+	showFrecent();
+	if (prefetchLevel > 0)
+	{
+		prefetchThread = thread(prefetchWorker);
+		atexit(stopPrefetch);
+	}
 
 	display = XOpenDisplay(NULL);
 	screen = DefaultScreen(display);
@@ -768,12 +1610,15 @@ int main()
 	colormap = DefaultColormap(display, screen);
 	root = DefaultRootWindow(display);
 	int depth = DefaultDepth(display, screen);
-	bool applicationsLoaded = false;
 
+	XInternAtoms(display, (char **)ATOM_NAMES, ATOM_COUNT, False, atoms); // one round trip for all atoms
+	locateMonitor();
 	updateScale();
 
+	shownWidth = width;
+	shownHeight = inputHeight + visibleRows() * rowHeight;
 	window = XCreateWindow(display, root,
-												 windowX, windowY, width, inputHeight,
+												 windowX, windowY, shownWidth, shownHeight,
 												 5, depth, InputOutput, visual, CWBackPixel, &attributes);
 	XSelectInput(display, window, ExposureMask | KeyPressMask | FocusChangeMask);
 	XIM xim = XOpenIM(display, 0, 0, 0);
@@ -788,11 +1633,8 @@ int main()
 
 	updateStyle();
 
-	setProperty("_NET_WM_WINDOW_TYPE", "_NET_WM_WINDOW_TYPE_DIALOG");
-	setProperty("_NET_WM_STATE", "_NET_WM_STATE_ABOVE");
-	setProperty("_NET_WM_STATE", "_NET_WM_STATE_MODAL");
-
-	Atom motifHintsAtom = XInternAtom(display, "_MOTIF_WM_HINTS", False);
+	setProperty(WM_WINDOW_TYPE, {WM_WINDOW_TYPE_DIALOG});
+	setProperty(WM_STATE, {WM_STATE_ABOVE, WM_STATE_MODAL});
 
 	struct
 	{
@@ -805,14 +1647,16 @@ int main()
 	hints.flags = 2;			 // MWM_HINTS_DECORATIONS
 	hints.decorations = 0; // 0 = no decorations
 
-	XChangeProperty(display, window, motifHintsAtom, motifHintsAtom, 32,
+	XChangeProperty(display, window, atoms[MOTIF_WM_HINTS], atoms[MOTIF_WM_HINTS], 32,
 									PropModeReplace, (unsigned char *)&hints, 5);
 
 	XMapWindow(display, window);
 
 	xftdraw = XftDrawCreate(display, window, visual, colormap);
+	reportRoundTrips("startup");
 
 	XEvent event;
+	string lastQuery = "";
 	while (1)
 	{
 		while (XCheckMaskEvent(display, ExposureMask | KeyPressMask | FocusChangeMask, &event))
@@ -824,33 +1668,59 @@ int main()
 			}
 			if (event.type == KeyPress)
 			{
+				const long received = LATENCY_LOG ? monotonicTime() : 0;
+				reportRoundTrips("idle"); // repaints and font prefetching since the last key, so they aren't counted against it
 				onKeyPress(event);
-				if (query.length() > 0)
+				if (queryi != lastQuery)
 				{
-					if (!applicationsLoaded)
+					if (query.length() > 0)
 					{
-						applications = awaitApps.get();
-						applicationsLoaded = true;
+						if (!applicationsLoaded)
+						{
+							loadApplications(awaitApps.get());
+						}
+						search();
 					}
-					search();
-				}
-				else
-				{
-					results = {};
+					else
+					{
+						showFrecent();
+					}
+					lastQuery = queryi;
+					selected = scroll = 0;
 				}
-				if (selected >= results.size())
+				render();
+				reportRoundTrips("keystroke"); // counted before the latency log's XSync, which would add one
+				if (LATENCY_LOG)
 				{
-					selected = 0;
+					XSync(display, False); // wait until the server has drawn everything
+					latencies.push_back({received, monotonicTime()});
 				}
-				XMoveResizeWindow(display, window, windowX, windowY, width, inputHeight + results.size() * rowHeight);
-				renderTextInput(true);
-				renderResults();
 			}
 			if (event.type == FocusOut)
 			{
 				exit(0);
 			}
 		}
+		if (!applicationsLoaded && awaitApps.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{ // replace the snapshot with the live list
+			loadApplications(awaitApps.get());
+			if (query.length() == 0)
+			{
+				const string selectedId = results.empty() ? "" : results[selected].id();
+				showFrecent();
+				selected = 0;
+				for (int i = 0; i < results.size(); i++)
+				{
+					if (results[i].id() == selectedId)
+					{ // keep the same app selected
+						selectResult(i);
+					}
+				}
+				render();
+			}
+		}
+		prefetchFont();
+		updatePrefetch();
 		cursorBlink();
 		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 	}
@@ -0,0 +1,234 @@
+#include <iostream>		 // for log output
+#include <unistd.h>		 // starting processes
+#include <fstream>		 // reading the latency log
+#include <string>			 // string type
+#include <vector>			 // flexible arrays
+#include <algorithm>	 // for sorting
+#include <cmath>			 // rounding percentiles
+#include <chrono>			 // sleep and duration
+#include <thread>			 // sleeping
+#include <csignal>		 // stopping Xvfb
+#include <sys/wait.h>	 // waiting for processes
+#include <filesystem>	 // temporary corpus
+#include <X11/Xlib.h>	 // X11 api
+#include <X11/keysym.h> // key codes
+#include <X11/extensions/XTest.h> // injecting key presses (requires libxtst)
+
+// Starts the launcher on a private Xvfb server, types scripted queries into it with XTest and reports how long each key
+// press took to be painted after the launcher received it. Usage: latency <launcher> [p50 p95 p99 thresholds in ms]
+
+namespace fs = std::filesystem;
+using std::string, std::vector, std::ifstream, std::ofstream;
+
+const int KEY_INTERVAL = 60; // ms between key presses, so that each is measured on its own
+const int CORPUS_SIZE = 2000;
+const string WORDS[] = {"text", "editor", "web", "browser", "private", "image", "viewer", "terminal", "music", "player",
+												"video", "mail", "office", "calculator", "files", "manager", "settings", "monitor", "archive", "paint"};
+const string SCRIPTS[] = { // \b is backspace
+		"firefox", "\b\b\b\b\b\b\b",
+		"text editor", "\b\b\b\b\b\b\b\b\b\b\b",
+		"e", "\b",
+		"web browser private", "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b",
+		"terminal", "\b\b\b\b", "ina", "\b\b\b\b\b\b\b"};
+
+long monotonicTime()
+{ // must match the clock used by the launcher
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void writeCorpus(const string &dir)
+{ // a fixed set of desktop files, so results are comparable between runs
+	fs::create_directories(dir);
+	const int wordCount = std::size(WORDS);
+	for (int i = 0; i < CORPUS_SIZE; i++)
+	{
+		const string a = WORDS[i % wordCount], b = WORDS[i / wordCount % wordCount], c = WORDS[i * 7 % wordCount];
+		ofstream outfile(dir + "/app" + std::to_string(i) + ".desktop");
+		outfile << "[Desktop Entry]\n";
+		outfile << "Name=" << a << " " << b << " " << i << "\n";
+		outfile << "GenericName=" << b << " " << c << "\n";
+		outfile << "Comment=A " << c << " for " << a << " and " << b << "\n";
+		outfile << "Keywords=" << a << ";" << c << ";\n";
+		outfile << "Exec=true %U\n";
+		outfile.close();
+	}
+}
+
+int start(const vector<string> &command)
+{
+	const int pid = fork();
+	if (pid == 0)
+	{
+		vector<char *> args;
+		for (const string &arg : command)
+		{
+			args.push_back(const_cast<char *>(arg.c_str()));
+		}
+		args.push_back(NULL);
+		execvp(args[0], &args[0]);
+		_exit(127);
+	}
+	return pid;
+}
+
+bool waitFor(const int pid, const int timeout)
+{
+	for (int i = 0; i < timeout / 10; i++)
+	{
+		if (waitpid(pid, NULL, WNOHANG) == pid)
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+double percentile(vector<double> values, const double p)
+{ // nearest rank
+	sort(values.begin(), values.end());
+	const int i = std::max((int)std::ceil(p / 100 * values.size()) - 1, 0);
+	return values[i];
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "usage: " << argv[0] << " <launcher> [p50 p95 p99 thresholds in ms]\n";
+		return 2;
+	}
+	const string launcher = fs::absolute(argv[1]);
+	const double thresholds[] = {argc > 2 ? atof(argv[2]) : 0, argc > 3 ? atof(argv[3]) : 0, argc > 4 ? atof(argv[4]) : 0};
+
+	char tmpTemplate[] = "/tmp/launcher-latency-XXXXXX";
+	const string tmp = mkdtemp(tmpTemplate);
+	writeCorpus(tmp + "/data/applications");
+	const string log = tmp + "/latency.log";
+
+	// Xvfb picks a free display and writes its number to the pipe once it is ready, so we never connect to someone
+	// else's server
+	int displayPipe[2];
+	pipe(displayPipe);
+	const int xvfb = start({"Xvfb", "-displayfd", std::to_string(displayPipe[1]), "-screen", "0", "1280x1024x24", "-nolisten", "tcp"});
+	close(displayPipe[1]);
+	string displayName = ":";
+	char c;
+	while (read(displayPipe[0], &c, 1) == 1 && c != '\n') // ends early if Xvfb exits without starting
+	{
+		displayName += c;
+	}
+	close(displayPipe[0]);
+	Display *display = displayName.length() > 1 ? XOpenDisplay(displayName.c_str()) : NULL;
+	int eventBase, errorBase, major, minor;
+	if (display == NULL || !XTestQueryExtension(display, &eventBase, &errorBase, &major, &minor))
+	{
+		std::cerr << "could not start Xvfb with the XTEST extension\n";
+		kill(xvfb, SIGTERM);
+		fs::remove_all(tmp);
+		return 2;
+	}
+	Window root = DefaultRootWindow(display);
+	XSelectInput(display, root, SubstructureNotifyMask);
+
+	setenv("DISPLAY", displayName.c_str(), 1);
+	setenv("XDG_DATA_HOME", (tmp + "/data").c_str(), 1); // corpus is found in the user applications dir
+	setenv("XDG_DATA_DIRS", (tmp + "/system").c_str(), 1);	// and no system applications are scanned
+	setenv("XDG_CONFIG_HOME", (tmp + "/config").c_str(), 1);
+	setenv("XDG_CACHE_HOME", (tmp + "/cache").c_str(), 1);
+	setenv("LAUNCHER_LATENCY_LOG", log.c_str(), 1);
+	fs::create_directories(tmp + "/config");
+	const int app = start({launcher});
+
+	Window window = 0;
+	for (int i = 0; i < 500 && window == 0; i++)
+	{ // wait for the launcher window to appear
+		XEvent event;
+		while (XPending(display))
+		{
+			XNextEvent(display, &event);
+			if (event.type == MapNotify)
+			{
+				window = event.xmap.window;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	if (window == 0)
+	{
+		std::cerr << "launcher window did not appear\n";
+		kill(app, SIGTERM);
+		kill(xvfb, SIGTERM);
+		fs::remove_all(tmp);
+		return 2;
+	}
+	XSetInputFocus(display, window, RevertToParent, CurrentTime);
+	XSync(display, False);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500)); // let the first paint and application loading finish
+
+	vector<long> injected;
+	for (const string &script : SCRIPTS)
+	{
+		for (const char c : script)
+		{
+			KeySym keysym = XStringToKeysym(string(1, c).c_str());
+			if (c == '\b' || c == ' ')
+			{
+				keysym = c == ' ' ? XK_space : XK_BackSpace;
+			}
+			const KeyCode keycode = XKeysymToKeycode(display, keysym);
+			injected.push_back(monotonicTime());
+			XTestFakeKeyEvent(display, keycode, True, CurrentTime);
+			XTestFakeKeyEvent(display, keycode, False, CurrentTime);
+			XFlush(display);
+			std::this_thread::sleep_for(std::chrono::milliseconds(KEY_INTERVAL));
+		}
+	}
+	const KeyCode escape = XKeysymToKeycode(display, XK_Escape); // the launcher writes its log as it exits
+	XTestFakeKeyEvent(display, escape, True, CurrentTime);
+	XTestFakeKeyEvent(display, escape, False, CurrentTime);
+	XFlush(display);
+	const bool exited = waitFor(app, 5000);
+	XCloseDisplay(display);
+	kill(xvfb, SIGTERM);
+	waitFor(xvfb, 5000);
+
+	vector<double> latencies, endToEnd; // from the launcher receiving each key press, and from it being injected
+	ifstream infile(log);
+	long received, painted;
+	while (infile >> received >> painted)
+	{
+		if (latencies.size() < injected.size())
+		{
+			endToEnd.push_back((painted - injected[latencies.size()]) / 1e6);
+			latencies.push_back((painted - received) / 1e6);
+		}
+	}
+	fs::remove_all(tmp);
+	if (!exited || latencies.size() != injected.size())
+	{
+		std::cerr << "expected " << injected.size() << " key presses to be painted, got " << latencies.size() << "\n";
+		if (!exited)
+		{
+			kill(app, SIGKILL);
+		}
+		return 1;
+	}
+
+	const double percentiles[] = {50, 95, 99};
+	bool passed = true;
+	std::cout << "key press to paint latency over " << latencies.size() << " key presses (from injection in brackets)\n";
+	for (int i = 0; i < 3; i++)
+	{ // only the launcher's own time is held to the thresholds, the rest depends on the X server and scheduling
+		const double value = percentile(latencies, percentiles[i]);
+		const bool ok = thresholds[i] <= 0 || value <= thresholds[i];
+		std::cout << "  p" << percentiles[i] << ": " << value << "ms (" << percentile(endToEnd, percentiles[i]) << "ms)";
+		if (thresholds[i] > 0)
+		{
+			std::cout << " (limit " << thresholds[i] << "ms)" << (ok ? "" : " FAILED");
+		}
+		std::cout << "\n";
+		passed = passed && ok;
+	}
+	return passed ? 0 : 1;
+}